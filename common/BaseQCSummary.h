@@ -0,0 +1,442 @@
+/*
+ *  Copyright (C) 2011-2106  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BASEQC_SUMMARY_H__
+#define __BASEQC_SUMMARY_H__
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "InputFile.h"
+
+/// Accumulates depth/quality summaries of baseQC stats records as they are
+/// written, so the metrics do not require a second pass over the stats file.
+/// Summaries are kept for the whole genome, for each chromosome, and
+/// optionally for each region added with addRegion.
+/// Genome and chromosome lines cover the positions that have a stats
+/// record.  Region lines cover every base of the region, counting a base
+/// without a record as depth 0.
+/// Records can also be accumulated into a separate Partial, which only
+/// reads the summary's settings and regions (so several threads can fill
+/// their own), and then merged into the summary in record order.
+class BaseQCSummary
+{
+private:
+    static const int NUM_THRESHOLDS = 3;
+
+    struct Counts
+    {
+        Counts()
+            : minPos(0x7FFFFFFF), maxPos(-1), bases(0), sumDepth(0),
+              numQ20(0), sumMapQ(0), mapQCount(0)
+        {
+            for(int i = 0; i < NUM_THRESHOLDS; i++)
+            {
+                atThreshold[i] = 0;
+            }
+        }
+
+        void add(int pos, int depth, int q20, double mapQ, int mapQCnt)
+        {
+            minPos = std::min(minPos, pos);
+            maxPos = std::max(maxPos, pos);
+            ++bases;
+            sumDepth += depth;
+            numQ20 += q20;
+            sumMapQ += mapQ;
+            mapQCount += mapQCnt;
+            for(int i = 0; i < NUM_THRESHOLDS; i++)
+            {
+                if(depth >= depthThreshold(i))
+                {
+                    ++atThreshold[i];
+                }
+            }
+        }
+
+        void merge(const Counts& other)
+        {
+            minPos = std::min(minPos, other.minPos);
+            maxPos = std::max(maxPos, other.maxPos);
+            bases += other.bases;
+            sumDepth += other.sumDepth;
+            numQ20 += other.numQ20;
+            sumMapQ += other.sumMapQ;
+            mapQCount += other.mapQCount;
+            for(int i = 0; i < NUM_THRESHOLDS; i++)
+            {
+                atThreshold[i] += other.atThreshold[i];
+            }
+        }
+
+        int minPos;
+        int maxPos;
+        unsigned long long bases;
+        unsigned long long sumDepth;
+        unsigned long long numQ20;
+        double sumMapQ;
+        unsigned long long mapQCount;
+        unsigned long long atThreshold[NUM_THRESHOLDS];
+    };
+
+public:
+    /// Counts for a set of records, see add/addLine/merge.
+    class Partial
+    {
+    public:
+        Partial()
+            : myGenome(),
+              myChroms(),
+              myChromNames(),
+              myChromIndex(),
+              myLastChrom(),
+              myLastChromIndex(-1),
+              myRegionCounts()
+        {
+        }
+
+    private:
+        friend class BaseQCSummary;
+
+        // Get the counts for the chromosome, adding it if it is new.
+        Counts& chromCounts(const char* chrom)
+        {
+            // Records are grouped by chromosome, so only look up the
+            // chromosome when it changes.
+            if((myLastChromIndex < 0) || (myLastChrom != chrom))
+            {
+                myLastChrom = chrom;
+                std::map<std::string, int>::iterator iter =
+                    myChromIndex.find(myLastChrom);
+                if(iter == myChromIndex.end())
+                {
+                    myLastChromIndex = myChroms.size();
+                    myChromIndex[myLastChrom] = myLastChromIndex;
+                    myChroms.push_back(Counts());
+                    myChromNames.push_back(myLastChrom);
+                }
+                else
+                {
+                    myLastChromIndex = iter->second;
+                }
+            }
+            return(myChroms[myLastChromIndex]);
+        }
+
+        Counts myGenome;
+        // Chromosomes in the order they were first seen.
+        std::vector<Counts> myChroms;
+        std::vector<std::string> myChromNames;
+        std::map<std::string, int> myChromIndex;
+        std::string myLastChrom;
+        int myLastChromIndex;
+        // Counts of the regions that have records, by region index.
+        std::map<int, Counts> myRegionCounts;
+    };
+
+    BaseQCSummary()
+        : myFullStats(true),
+          myTotals(),
+          myRegionChroms(),
+          myRegions()
+    {
+    }
+
+    /// Set whether the records contain depth and Q20 counts (full header)
+    /// or only the mapping quality columns (short header).
+    void setFullStats(bool fullStats)
+    {
+        myFullStats = fullStats;
+    }
+
+    /// Add a region (0 based, end not included) to summarize separately.
+    /// Returns false if the region is invalid (start >= end).
+    bool addRegion(const char* chrom, int start, int end)
+    {
+        if(start >= end)
+        {
+            return(false);
+        }
+        Region region;
+        region.start = start;
+        region.end = end;
+        region.maxEnd = end;
+        region.chrom = chrom;
+        myRegionChroms[chrom].push_back(myRegions.size());
+        myRegions.push_back(region);
+        return(true);
+    }
+
+    /// Must be called after the last addRegion and before the first add.
+    void finishRegions()
+    {
+        for(RegionChromMap::iterator iter = myRegionChroms.begin();
+            iter != myRegionChroms.end(); iter++)
+        {
+            // Sort the chromosome's regions by start, tracking the largest
+            // end seen so far so lookups can stop scanning early.
+            std::vector<int>& indices = iter->second;
+            std::sort(indices.begin(), indices.end(),
+                      RegionStartLess(myRegions));
+            int maxEnd = 0;
+            for(unsigned int i = 0; i < indices.size(); i++)
+            {
+                maxEnd = std::max(maxEnd, myRegions[indices[i]].end);
+                myRegions[indices[i]].maxEnd = maxEnd;
+            }
+        }
+    }
+
+    /// Add a stats record.  depth and numQ20 are ignored if the records
+    /// are not full stats.
+    void add(const char* chrom, int pos, int depth, int numQ20,
+             double sumMapQ, int mapQCount)
+    {
+        add(myTotals, chrom, pos, depth, numQ20, sumMapQ, mapQCount);
+    }
+
+    /// Add a stats record to the partial counts.
+    void add(Partial& partial, const char* chrom, int pos, int depth,
+             int numQ20, double sumMapQ, int mapQCount) const
+    {
+        partial.myGenome.add(pos, depth, numQ20, sumMapQ, mapQCount);
+        partial.chromCounts(chrom).add(pos, depth, numQ20, sumMapQ, mapQCount);
+
+        if(myRegions.empty())
+        {
+            return;
+        }
+        RegionChromMap::const_iterator regionIter =
+            myRegionChroms.find(partial.myLastChrom);
+        if(regionIter == myRegionChroms.end())
+        {
+            return;
+        }
+        // Find the last region starting at or before pos and scan back
+        // over every region that could still contain it.
+        const std::vector<int>& indices = regionIter->second;
+        std::vector<int>::const_iterator upper =
+            std::upper_bound(indices.begin(), indices.end(), pos,
+                             PosBeforeRegion(myRegions));
+        while(upper != indices.begin())
+        {
+            --upper;
+            const Region& region = myRegions[*upper];
+            if(region.maxEnd <= pos)
+            {
+                break;
+            }
+            if(region.end > pos)
+            {
+                partial.myRegionCounts[*upper].add(pos, depth, numQ20,
+                                                   sumMapQ, mapQCount);
+            }
+        }
+    }
+
+    /// Parse a stats data line (full or short format, see setFullStats)
+    /// and add it.  Returns false if the line could not be parsed.
+    bool addLine(const char* line)
+    {
+        return(addLine(myTotals, line));
+    }
+
+    /// Parse a stats data line and add it to the partial counts.
+    bool addLine(Partial& partial, const char* line) const
+    {
+        char chrom[100];
+        int pos = 0;
+        double avgMapQ = 0;
+        int avgMapQCount = 0;
+        int depth = 0;
+        int numQ20 = 0;
+
+        if(myFullStats)
+        {
+            if(sscanf(line, "%99s\t%d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%*d\t%lf\t%d\t%d\t%d",
+                      chrom, &pos, &avgMapQ, &avgMapQCount,
+                      &depth, &numQ20) != 6)
+            {
+                return(false);
+            }
+        }
+        else if(sscanf(line, "%99s\t%d\t%*d\t%lf\t%d",
+                       chrom, &pos, &avgMapQ, &avgMapQCount) != 4)
+        {
+            return(false);
+        }
+        add(partial, chrom, pos, depth, numQ20, avgMapQ * avgMapQCount,
+            avgMapQCount);
+        return(true);
+    }
+
+    /// Merge partial counts into the summary.  Partials must be merged in
+    /// record order to keep the chromosomes in the order they were seen.
+    void merge(const Partial& partial)
+    {
+        myTotals.myGenome.merge(partial.myGenome);
+        for(unsigned int i = 0; i < partial.myChroms.size(); i++)
+        {
+            myTotals.chromCounts(partial.myChromNames[i].c_str()).merge(partial.myChroms[i]);
+        }
+        for(std::map<int, Counts>::const_iterator iter =
+                partial.myRegionCounts.begin();
+            iter != partial.myRegionCounts.end(); iter++)
+        {
+            myTotals.myRegionCounts[iter->first].merge(iter->second);
+        }
+    }
+
+    /// Write the summary report.  Returns false if it could not be written.
+    bool write(const char* filename)
+    {
+        IFILE outputFile = ifopen(filename, "w");
+        if(outputFile == NULL)
+        {
+            std::cerr << "Failed to open summary file: " << filename
+                      << std::endl;
+            return(false);
+        }
+        ifprintf(outputFile, "Level\tchrom\tchromStart\tchromEnd\tBases\tMeanDepth\tPctDepth>=10\tPctDepth>=20\tPctDepth>=30\tQ20Fraction\tAverageMapQuality\n");
+
+        // chromStart/chromEnd are the first/last record on the chromosome,
+        // but the counts only include the positions that have a record.
+        ifprintf(outputFile, "genome\t.\t.\t.");
+        writeCounts(outputFile, myTotals.myGenome, myTotals.myGenome.bases);
+        for(unsigned int i = 0; i < myTotals.myChroms.size(); i++)
+        {
+            const Counts& chromCounts = myTotals.myChroms[i];
+            ifprintf(outputFile, "chrom\t%s\t%d\t%d",
+                     myTotals.myChromNames[i].c_str(), chromCounts.minPos,
+                     chromCounts.maxPos + 1);
+            writeCounts(outputFile, chromCounts, chromCounts.bases);
+        }
+        Counts noRecords;
+        for(unsigned int i = 0; i < myRegions.size(); i++)
+        {
+            std::map<int, Counts>::const_iterator iter =
+                myTotals.myRegionCounts.find(i);
+            // Bases of the region without a record have no coverage.
+            ifprintf(outputFile, "region\t%s\t%d\t%d",
+                     myRegions[i].chrom.c_str(), myRegions[i].start,
+                     myRegions[i].end);
+            writeCounts(outputFile,
+                        (iter == myTotals.myRegionCounts.end()) ? noRecords : iter->second,
+                        myRegions[i].end - myRegions[i].start);
+        }
+        ifclose(outputFile);
+        return(true);
+    }
+
+private:
+    struct Region
+    {
+        std::string chrom;
+        int start;
+        int end;
+        // Largest end of this and all earlier regions on the chromosome.
+        int maxEnd;
+    };
+
+    // Orders region indices by region start.
+    class RegionStartLess
+    {
+    public:
+        RegionStartLess(const std::vector<Region>& regions)
+            : myRegionsRef(regions) {}
+        bool operator()(int lhs, int rhs) const
+        {
+            return(myRegionsRef[lhs].start < myRegionsRef[rhs].start);
+        }
+    private:
+        const std::vector<Region>& myRegionsRef;
+    };
+
+    // Compares a position to the start of a region index.
+    class PosBeforeRegion
+    {
+    public:
+        PosBeforeRegion(const std::vector<Region>& regions)
+            : myRegionsRef(regions) {}
+        bool operator()(int pos, int index) const
+        {
+            return(pos < myRegionsRef[index].start);
+        }
+    private:
+        const std::vector<Region>& myRegionsRef;
+    };
+
+    typedef std::map<std::string, std::vector<int> > RegionChromMap;
+
+    static int depthThreshold(int index)
+    {
+        return((index + 1) * 10);
+    }
+
+    // Write the columns from Bases on, ending the line.  The depth
+    // metrics are averaged over numBases, which counts bases that have no
+    // stats record.
+    void writeCounts(IFILE outputFile, const Counts& counts,
+                     unsigned long long numBases)
+    {
+        ifprintf(outputFile, "\t%llu", numBases);
+
+        if(myFullStats && (numBases != 0))
+        {
+            ifprintf(outputFile, "\t%.3f",
+                     (double)counts.sumDepth / numBases);
+            for(int i = 0; i < NUM_THRESHOLDS; i++)
+            {
+                ifprintf(outputFile, "\t%.3f",
+                         100.0 * counts.atThreshold[i] / numBases);
+            }
+        }
+        else
+        {
+            ifprintf(outputFile, "\tNA\tNA\tNA\tNA");
+        }
+
+        if(myFullStats && (counts.sumDepth != 0))
+        {
+            ifprintf(outputFile, "\t%.3f",
+                     (double)counts.numQ20 / counts.sumDepth);
+        }
+        else
+        {
+            ifprintf(outputFile, "\tNA");
+        }
+
+        if(counts.mapQCount != 0)
+        {
+            ifprintf(outputFile, "\t%.3f\n", counts.sumMapQ / counts.mapQCount);
+        }
+        else
+        {
+            ifprintf(outputFile, "\tNA\n");
+        }
+    }
+
+    bool myFullStats;
+    Partial myTotals;
+    RegionChromMap myRegionChroms;
+    std::vector<Region> myRegions;
+};
+
+#endif
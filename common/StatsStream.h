@@ -0,0 +1,40 @@
+/*
+ *  Copyright (C) 2011-2106  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATS_STREAM_H__
+#define __STATS_STREAM_H__
+
+#include <string.h>
+#include <sys/stat.h>
+
+/// Returns true if the specified stats file should be read as a stream
+/// (as it is written, without reopening it): "-" (stdin) or a named pipe.
+inline bool isStatsStream(const char* filename)
+{
+    if(strcmp(filename, "-") == 0)
+    {
+        return(true);
+    }
+    struct stat fileStat;
+    if(stat(filename, &fileStat) != 0)
+    {
+        return(false);
+    }
+    return(S_ISFIFO(fileStat.st_mode));
+}
+
+#endif
@@ -17,6 +17,9 @@
 
 #include "StringBasics.h"
 #include "Parameters.h"
+#include "MultiplexedInput.h"
+#include "../../common/BaseQCSummary.h"
+#include "../../common/StatsStream.h"
 #include <map>
 
 struct StoredInfo
@@ -42,19 +45,28 @@ struct StoredInfo
 };
     
 
-bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& minPos);
+bool readInputLine(int fileIndex, String& line);
+bool readNextLine(int fileIndex, StoredInfo& nextLine, int& minChrom, int& minPos);
 void updateSummary(const StoredInfo& nextLine, StoredInfo& sumLine);
 bool writeSummary(IFILE outputFile, StoredInfo& summaryLine);
 void initStoredInfo(StoredInfo& info);
 
 int setupChromMap(const String &chrListFile, 
                    std::map <std::string, int> &chromMap);
+int readSummaryRegions(const String& regionListFile, BaseQCSummary& summary);
 
 std::map <std::string, int> chromMap;
 std::map <std::string, int> chromError;
 
 std::map<std::string,int>::iterator chromMapIter;
 
+// Input files are either opened with ifopen (inputFiles) or, for stdin and
+// named pipes, read through streamInput (streamIndices).
+std::vector<const char*> inputNames;
+std::vector<IFILE> inputFiles;
+std::vector<int> streamIndices;
+MultiplexedInput streamInput;
+
 bool fullHeader = false;
 
 char* chromBuffer = new char[100];
@@ -65,10 +77,17 @@ const char* shortHdrStr = "chrom\tchromStart\tZeroMapQual\tAverageMapQuality\tAv
 void usage()
 {
     std::cerr << "Merge baseQC Cout-Based Summary Statistics.\n";
-    std::cerr << "Usage: mergeBaseQCSumStats --out <outputStatsFile> [--chrList <faiFile>] <inputStatsFiles>\n"
-              << "\t--out output merged stats file\n"
+    std::cerr << "Usage: mergeBaseQCSumStats --out <outputStatsFile> [--chrList <faiFile>] [--summary <summaryFile> [--regionList <regionFile>]] <inputStatsFiles>\n"
+              << "\t--out output merged stats file ('-' for stdout)\n"
               << "\t--chrList file containing order of chromosome names in the first tab-delimited column\n"
+              << "\t--summary write per chromosome depth/quality metrics of the merged stats to this file\n"
+              << "\t\tChromosome metrics only cover positions with a stats record.\n"
+              << "\t--regionList also write summary metrics for each region in this file\n"
+              << "\t\tRegion metrics cover every base, bases without a record have depth 0.\n"
+              << "\t\tFormated as chr<tab>start_pos<tab>end_pos, 0 based with end_pos not included.\n"
               << "\tinputStatsFiles space separated list of files to merge.\n"
+              << "\t\t'-' (stdin) and named pipes are read as they are written,\n"
+              << "\t\tso they must be uncompressed.\n"
               << "\n";
 
 }
@@ -78,10 +97,14 @@ int main(int argc, char ** argv)
 {
     String output = "";
     String chrListFile = "";
+    String summaryFile = "";
+    String regionListFile = "";
     ParameterList inputParameters;
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_STRINGPARAMETER("out", &output)
         LONG_STRINGPARAMETER("chrList", &chrListFile)
+        LONG_STRINGPARAMETER("summary", &summaryFile)
+        LONG_STRINGPARAMETER("regionList", &regionListFile)
         END_LONG_PARAMETERS();
    
     inputParameters.Add(new LongParameters ("Input Parameters", 
@@ -107,18 +130,38 @@ int main(int argc, char ** argv)
         return(-1);
     }
 
+    if(!regionListFile.IsEmpty() && summaryFile.IsEmpty())
+    {
+        std::cerr << "--regionList is only used with --summary, exiting.\n";
+        usage();
+        return(-1);
+    }
+
     if(setupChromMap(chrListFile, chromMap) != 0)
     {
         return(-1);
     }
+
+    BaseQCSummary qcSummary;
+    if(!regionListFile.IsEmpty() &&
+       (readSummaryRegions(regionListFile, qcSummary) != 0))
+    {
+        return(-1);
+    }
     
     // Open the output file.
     IFILE outputFile = ifopen(output, "w");
+    if(outputFile == NULL)
+    {
+        std::cerr << "Failed to open " << output << " for writing.\n";
+        return(-1);
+    }
 
     int numFiles = argc - numArgsProcessed;
-    std::vector<IFILE> inputFiles;
     std::vector<StoredInfo> nextLine;
+    inputNames.resize(numFiles);
     inputFiles.resize(numFiles);
+    streamIndices.resize(numFiles);
     nextLine.resize(numFiles);
 
     String header;
@@ -129,18 +172,38 @@ int main(int argc, char ** argv)
     int nextMinChrom = 0x7FFFFFFF;
     int nextMinPos = 0x7FFFFFFF;
 
-    bool fail = false;
+    // Open all of the stats input files before reading any of them so
+    // every stream is drained while waiting on any one of them.
     for(int i = 0; i < numFiles; i++)
     {
-        // Open the stats input files.
-        inputFiles[i] = ifopen(argv[numArgsProcessed+i], "r");
-        if(inputFiles[i] == NULL)
+        inputNames[i] = argv[numArgsProcessed+i];
+        inputFiles[i] = NULL;
+        streamIndices[i] = -1;
+        if(isStatsStream(inputNames[i]))
         {
-            std::cerr << "Failed to open " << argv[numArgsProcessed+i] << " for reading.\n";
+            streamIndices[i] = streamInput.open(inputNames[i]);
+        }
+        else
+        {
+            inputFiles[i] = ifopen(inputNames[i], "r");
+        }
+        if((inputFiles[i] == NULL) && (streamIndices[i] < 0))
+        {
+            std::cerr << "Failed to open " << inputNames[i] << " for reading.\n";
             exit(-1);
         }
+    }
+
+    bool fail = false;
+    for(int i = 0; i < numFiles; i++)
+    {
         // Read the first line (this is the header).
-        header.ReadLine(inputFiles[i]);
+        if(!readInputLine(i, header))
+        {
+            std::cerr << "ERROR: " << inputNames[i] << " ended before its header.\n";
+            fail = true;
+            continue;
+        }
 
         // Validate the header.
         if(header == fullHdrStr)
@@ -153,13 +216,13 @@ int main(int argc, char ** argv)
         }
         else
         {
-            std::cerr << "ERROR: Only a full stats header and one with 'chrom, chromStart, ZeroMapQual, AverageMapQuality, AverageMapQualCount' are accepted.\nThe header in " << argv[numArgsProcessed+i] << " is not accepted.\n";
+            std::cerr << "ERROR: Only a full stats header and one with 'chrom, chromStart, ZeroMapQual, AverageMapQuality, AverageMapQualCount' are accepted.\nThe header in " << inputNames[i] << " is not accepted.\n";
             fail = true;
         }
        
 
         // Read the first data line
-        if(!readNextLine(inputFiles[i], nextLine[i], minChrom, minPos))
+        if(!readNextLine(i, nextLine[i], minChrom, minPos))
         {
             // there is not another record, so set chrom/pos to 0x7FFFFFFF
             nextLine[i].chrom = 0x7FFFFFFF;
@@ -174,6 +237,8 @@ int main(int argc, char ** argv)
     // write the header.
     ifprintf(outputFile, "%s\n", header.c_str());
 
+    qcSummary.setFullStats(fullHeader);
+
     StoredInfo sumLine;
     initStoredInfo(sumLine);
 
@@ -197,7 +262,7 @@ int main(int argc, char ** argv)
                 // This is a min line, so accumulate
                 updateSummary(nextLine[i], sumLine);
                 // Used this line, so read the next line.
-                if(!readNextLine(inputFiles[i], nextLine[i], nextMinChrom, nextMinPos))
+                if(!readNextLine(i, nextLine[i], nextMinChrom, nextMinPos))
                 {
                     // there is not another record, so set chrom/pos to 0x7FFFFFFF
                     nextLine[i].chrom = 0x7FFFFFFF;
@@ -219,6 +284,12 @@ int main(int argc, char ** argv)
         }
         if(!done)
         {
+            if(!summaryFile.IsEmpty())
+            {
+                qcSummary.add(sumLine.chromStr.c_str(), sumLine.start,
+                              sumLine.depth, sumLine.numQ20,
+                              sumLine.sumMapQ, sumLine.avgMapQCount);
+            }
             writeSummary(outputFile, sumLine);
         }
         minChrom = nextMinChrom;
@@ -230,16 +301,52 @@ int main(int argc, char ** argv)
     ifclose(outputFile);
     for(int i = 0; i < numFiles; i++)
     {
-        ifclose(inputFiles[i]);
+        if(inputFiles[i] != NULL)
+        {
+            ifclose(inputFiles[i]);
+        }
+        else
+        {
+            streamInput.close(streamIndices[i]);
+        }
     }
 
     std::cerr << "Done writing to " << output << std::endl;
 
+    if(!summaryFile.IsEmpty())
+    {
+        if(!qcSummary.write(summaryFile))
+        {
+            return(-1);
+        }
+        std::cerr << "Done writing summary to " << summaryFile << std::endl;
+    }
+
     return(0);
 }
 
 
-bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& minPos)
+bool readInputLine(int fileIndex, String& line)
+{
+    if(inputFiles[fileIndex] != NULL)
+    {
+        return(line.ReadLine(inputFiles[fileIndex]) >= 0);
+    }
+    if(streamInput.getLine(streamIndices[fileIndex], line))
+    {
+        return(true);
+    }
+    if(streamInput.failed(streamIndices[fileIndex]))
+    {
+        // Do not treat a failed read as the end of the input.
+        std::cerr << "Failed reading from " << inputNames[fileIndex] << ", exiting.\n";
+        exit(-1);
+    }
+    return(false);
+}
+
+
+bool readNextLine(int fileIndex, StoredInfo& nextLine, int& minChrom, int& minPos)
 {
     double avgMapQ = 0;
 
@@ -247,7 +354,7 @@ bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& min
 
 
     // Read the first data line
-    if(dataLine.ReadLine(inputFile) < 0)
+    if(!readInputLine(fileIndex, dataLine))
     {
         return(false);
     }
@@ -264,7 +371,7 @@ bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& min
                   &avgMapQ, &(nextLine.avgMapQCount), 
                   &(nextLine.depth), &(nextLine.numQ20)) != 17)
         {
-            std::cerr << "Failed reading line from " << inputFile->getFileName() << "\n";
+            std::cerr << "Failed reading line from " << inputNames[fileIndex] << "\n";
             exit(-1);
         }
     }
@@ -273,7 +380,7 @@ bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& min
                    &(nextLine.numZeroMapQ), 
                    &avgMapQ, &(nextLine.avgMapQCount)) != 5)
     {
-        std::cerr << "Failed reading line from " << inputFile->getFileName() << "\n";
+        std::cerr << "Failed reading line from " << inputNames[fileIndex] << "\n";
         exit(-1);
     }
     
@@ -286,7 +393,7 @@ bool readNextLine(IFILE inputFile, StoredInfo& nextLine, int& minChrom, int& min
         {
             std::cerr << "Skipping chromosome " << chromBuffer << std::endl;
         }
-        return(readNextLine(inputFile, nextLine, minChrom, minPos));
+        return(readNextLine(fileIndex, nextLine, minChrom, minPos));
     }
     nextLine.chrom = chromMapIter->second;
     nextLine.chromStr = chromBuffer;
@@ -516,3 +623,38 @@ int setupChromMap(const String &chrListFile, std::map <std::string, int> &chromM
     return(0);
 }
 
+
+
+int readSummaryRegions(const String& regionListFile, BaseQCSummary& summary)
+{
+    IFILE regionList = ifopen(regionListFile.c_str(), "r");
+    if(regionList == NULL)
+    {
+        std::cerr << "Failed to open regionList: " << regionListFile << std::endl;
+        return(-1);
+    }
+
+    String regionLine;
+    int start = 0;
+    int end = 0;
+    while(regionLine.ReadLine(regionList) >= 0)
+    {
+        if(sscanf(regionLine.c_str(), "%99s\t%d\t%d",
+                  chromBuffer, &start, &end) != 3)
+        {
+            if(!regionLine.IsEmpty())
+            {
+                std::cerr << "Invalid Line found in region list, continuing.\n";
+            }
+            continue;
+        }
+        if(!summary.addRegion(chromBuffer, start, end))
+        {
+            std::cerr << "Invalid region " << chromBuffer << ":" << start
+                      << "-" << end << ", start must be < end, continuing.\n";
+        }
+    }
+    ifclose(regionList);
+    summary.finishRegions();
+    return(0);
+}
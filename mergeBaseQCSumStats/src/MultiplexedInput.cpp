@@ -0,0 +1,297 @@
+/*
+ *  Copyright (C) 2011-2106  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MultiplexedInput.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+
+MultiplexedInput::MultiplexedInput()
+    : myStreams()
+{
+}
+
+
+MultiplexedInput::~MultiplexedInput()
+{
+    for(unsigned int i = 0; i < myStreams.size(); i++)
+    {
+        close(i);
+    }
+}
+
+
+int MultiplexedInput::open(const char* filename)
+{
+    int fd = -1;
+    if(strcmp(filename, "-") == 0)
+    {
+        // stdin can only be read once.
+        for(unsigned int i = 0; i < myStreams.size(); i++)
+        {
+            if(myStreams[i].name == "-")
+            {
+                std::cerr << "stdin ('-') can only be specified once.\n";
+                return(-1);
+            }
+        }
+        fd = STDIN_FILENO;
+    }
+    else
+    {
+        // Opening a named pipe non-blocking returns immediately even if the
+        // producer has not opened it yet, so the order in which the
+        // producers start does not matter.
+        fd = ::open(filename, O_RDONLY | O_NONBLOCK);
+    }
+    if(fd < 0)
+    {
+        return(-1);
+    }
+
+    Stream stream;
+    stream.fd = fd;
+    stream.origFlags = fcntl(fd, F_GETFL);
+    if((stream.origFlags == -1) ||
+       (fcntl(fd, F_SETFL, stream.origFlags | O_NONBLOCK) == -1))
+    {
+        std::cerr << "Failed to set non-blocking mode on " << filename
+                  << ": " << strerror(errno) << std::endl;
+        if(fd != STDIN_FILENO)
+        {
+            ::close(fd);
+        }
+        return(-1);
+    }
+    stream.eof = false;
+    stream.error = false;
+    stream.name = filename;
+    stream.buffer.resize(READ_SIZE + 1);
+    stream.start = 0;
+    stream.end = 0;
+    myStreams.push_back(stream);
+    return(myStreams.size() - 1);
+}
+
+
+bool MultiplexedInput::getLine(int index, String& line)
+{
+    Stream& stream = myStreams[index];
+    unsigned int searched = stream.start;
+    while(!stream.error)
+    {
+        // Look for the end of the line in the data not yet searched.
+        char* newline = NULL;
+        if(searched < stream.end)
+        {
+            newline = (char*)memchr(&(stream.buffer[searched]), '\n',
+                                    stream.end - searched);
+        }
+        if(newline != NULL)
+        {
+            *newline = '\0';
+            line = &(stream.buffer[stream.start]);
+            stream.start = newline - &(stream.buffer[0]) + 1;
+            return(true);
+        }
+        if(stream.eof)
+        {
+            if(stream.start == stream.end)
+            {
+                return(false);
+            }
+            // Last line without a trailing newline.  There is always room
+            // for the terminator after the data.
+            stream.buffer[stream.end] = '\0';
+            line = &(stream.buffer[stream.start]);
+            stream.start = stream.end;
+            return(true);
+        }
+
+        // Need more data, fillBuffers may move the unconsumed data to the
+        // front of the buffer, so track the search position as an offset.
+        searched = stream.end - stream.start;
+        if(!fillBuffers(index))
+        {
+            return(false);
+        }
+        searched += stream.start;
+    }
+    return(false);
+}
+
+
+void MultiplexedInput::close(int index)
+{
+    Stream& stream = myStreams[index];
+    if(stream.fd < 0)
+    {
+        return;
+    }
+    if(stream.fd == STDIN_FILENO)
+    {
+        // Leave stdin the way it was found.
+        fcntl(stream.fd, F_SETFL, stream.origFlags);
+    }
+    else
+    {
+        ::close(stream.fd);
+    }
+    stream.fd = -1;
+    stream.eof = true;
+    std::vector<char>().swap(stream.buffer);
+    stream.start = 0;
+    stream.end = 0;
+}
+
+
+bool MultiplexedInput::failed(int index)
+{
+    return(myStreams[index].error);
+}
+
+
+const char* MultiplexedInput::getFileName(int index)
+{
+    return(myStreams[index].name.c_str());
+}
+
+
+bool MultiplexedInput::fillBuffers(int waitIndex)
+{
+    std::vector<struct pollfd> pollFds;
+    std::vector<int> pollIndices;
+
+    for(unsigned int i = 0; i < myStreams.size(); i++)
+    {
+        Stream& stream = myStreams[i];
+        if((stream.fd < 0) || stream.eof)
+        {
+            continue;
+        }
+        // Streams that are not being waited on are only read until they
+        // have MAX_BUFFERED bytes waiting to be consumed.
+        if(((int)i != waitIndex) &&
+           (stream.end - stream.start >= MAX_BUFFERED))
+        {
+            continue;
+        }
+        struct pollfd pollFd;
+        pollFd.fd = stream.fd;
+        pollFd.events = POLLIN;
+        pollFd.revents = 0;
+        pollFds.push_back(pollFd);
+        pollIndices.push_back(i);
+    }
+
+    if(pollFds.empty())
+    {
+        return(true);
+    }
+
+    if(poll(&(pollFds[0]), pollFds.size(), -1) < 0)
+    {
+        if(errno == EINTR)
+        {
+            return(true);
+        }
+        std::cerr << "Failed polling the input streams: "
+                  << strerror(errno) << std::endl;
+        myStreams[waitIndex].error = true;
+        return(false);
+    }
+
+    for(unsigned int i = 0; i < pollFds.size(); i++)
+    {
+        // Only read streams that poll reported, a named pipe that has not
+        // yet been opened by its producer reads as end of file.
+        if(pollFds[i].revents == 0)
+        {
+            continue;
+        }
+        int index = pollIndices[i];
+        Stream& stream = myStreams[index];
+        unsigned int maxBuffered = MAX_BUFFERED;
+        if((index == waitIndex) &&
+           (stream.end - stream.start >= MAX_BUFFERED))
+        {
+            // Allow one more read of the stream being waited on so lines
+            // longer than MAX_BUFFERED can still be read.
+            maxBuffered = stream.end - stream.start + 1;
+        }
+        // A failed stream other than the one being waited on is reported
+        // when it is next read.
+        if(!readAvailable(stream, maxBuffered) && (index == waitIndex))
+        {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+bool MultiplexedInput::readAvailable(Stream& stream, unsigned int maxBuffered)
+{
+    while(stream.end - stream.start < maxBuffered)
+    {
+        // Make room for the next read (plus a terminator), first by
+        // reclaiming the space of the consumed data, then by growing.
+        if(stream.buffer.size() < stream.end + READ_SIZE + 1)
+        {
+            if(stream.start != 0)
+            {
+                memmove(&(stream.buffer[0]), &(stream.buffer[stream.start]),
+                        stream.end - stream.start);
+                stream.end -= stream.start;
+                stream.start = 0;
+            }
+            if(stream.buffer.size() < stream.end + READ_SIZE + 1)
+            {
+                stream.buffer.resize(stream.end + READ_SIZE + 1);
+            }
+        }
+
+        ssize_t numRead = read(stream.fd, &(stream.buffer[stream.end]), READ_SIZE);
+        if(numRead > 0)
+        {
+            stream.end += numRead;
+        }
+        else if(numRead == 0)
+        {
+            stream.eof = true;
+            return(true);
+        }
+        else if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            // Nothing more available right now.
+            return(true);
+        }
+        else if(errno != EINTR)
+        {
+            std::cerr << "Failed reading from " << stream.name << ": "
+                      << strerror(errno) << std::endl;
+            stream.eof = true;
+            stream.error = true;
+            return(false);
+        }
+    }
+    return(true);
+}
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2011-2106  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MULTIPLEXED_INPUT_H__
+#define __MULTIPLEXED_INPUT_H__
+
+#include <string>
+#include <vector>
+#include "StringBasics.h"
+
+/// Line reader for a set of uncompressed streams (stdin, "-", and named
+/// pipes) that are read with non-blocking I/O.
+/// Whenever a caller waits on one stream, every other open stream that has
+/// data available is also drained into its own buffer, up to MAX_BUFFERED
+/// bytes per stream.  So while one producer is slow, the producers of the
+/// other streams can run ahead by up to MAX_BUFFERED plus the pipe capacity
+/// before they block on a full pipe.
+class MultiplexedInput
+{
+public:
+    MultiplexedInput();
+    ~MultiplexedInput();
+
+    /// Open the specified stream for reading, returning the index used to
+    /// refer to it or -1 on failure.
+    int open(const char* filename);
+
+    /// Read the next line (without the newline) from the specified stream.
+    /// Blocks until a full line (or the end of the stream) is available.
+    /// Returns false if the end of the stream was reached with nothing read
+    /// or if reading the stream failed (see failed).
+    bool getLine(int index, String& line);
+
+    /// Returns true if reading the specified stream failed.
+    bool failed(int index);
+
+    /// Close the specified stream.
+    void close(int index);
+
+    const char* getFileName(int index);
+
+private:
+    // Maximum amount of unconsumed data buffered for a stream that is not
+    // currently being waited on.
+    static const unsigned int MAX_BUFFERED = 1 << 20;
+    static const unsigned int READ_SIZE = 1 << 16;
+
+    struct Stream
+    {
+        int fd;
+        int origFlags;
+        bool eof;
+        bool error;
+        std::string name;
+        std::vector<char> buffer;
+        // Unconsumed data is buffer[start, end).
+        unsigned int start;
+        unsigned int end;
+    };
+
+    // Wait until at least one stream has data, reading from every stream
+    // that is ready.  Returns false if polling or reading waitIndex failed.
+    bool fillBuffers(int waitIndex);
+    // Read everything currently available for the stream, up to the
+    // specified amount of buffered data.  A read error is reported, ends
+    // the stream, and marks it as failed.
+    bool readAvailable(Stream& stream, unsigned int maxBuffered);
+
+    std::vector<Stream> myStreams;
+};
+
+#endif
@@ -29,6 +29,45 @@ let "status |= $?"
 diff results/mergeBaseQCSumFromFileShort.log expected/mergeBaseQCSumFromFileShort.log
 let "status |= $?"
 
+../../bin/mergeBaseQCSumStats --out results/mergeBaseQCSumSummary.stats --summary results/mergeBaseQCSumSummary.txt --regionList testFiles/summaryRegions.txt testFiles/test1.stats testFiles/test2.stats testFiles/test3.stats testFiles/test4.stats testFiles/test5.stats 2> results/mergeBaseQCSumSummary.log
+let "status |= $?"
+diff results/mergeBaseQCSumSummary.stats expected/mergeBaseQCSum.stats
+let "status |= $?"
+diff results/mergeBaseQCSumSummary.txt expected/mergeBaseQCSumSummary.txt
+let "status |= $?"
+diff results/mergeBaseQCSumSummary.log expected/mergeBaseQCSumSummary.log
+let "status |= $?"
+
+# Read from stdin and named pipes, writing to stdout.
+rm -f results/test2short.fifo results/test3short.fifo results/test4short.fifo results/test5short.fifo
+mkfifo results/test2short.fifo results/test3short.fifo results/test4short.fifo results/test5short.fifo
+cat testFiles/test2short.stats > results/test2short.fifo &
+cat testFiles/test3short.stats > results/test3short.fifo &
+cat testFiles/test4short.stats > results/test4short.fifo &
+cat testFiles/test5short.stats > results/test5short.fifo &
+cat testFiles/test1short.stats | ../../bin/mergeBaseQCSumStats --out - - results/test2short.fifo results/test3short.fifo results/test4short.fifo results/test5short.fifo > results/mergeBaseQCSumStreamShort.stats 2> results/mergeBaseQCSumStreamShort.log
+let "status |= $?"
+wait
+rm -f results/test2short.fifo results/test3short.fifo results/test4short.fifo results/test5short.fifo
+diff results/mergeBaseQCSumStreamShort.stats expected/mergeBaseQCSumShort.stats
+let "status |= $?"
+diff results/mergeBaseQCSumStreamShort.log expected/mergeBaseQCSumStreamShort.log
+let "status |= $?"
+
+# A named pipe whose producer exits without writing anything must fail.
+rm -f results/empty.fifo
+mkfifo results/empty.fifo
+: > results/empty.fifo &
+../../bin/mergeBaseQCSumStats --out results/mergeBaseQCSumEmptyStream.stats testFiles/test1short.stats results/empty.fifo 2> results/mergeBaseQCSumEmptyStream.log
+if [ $? == 0 ]
+then
+  status=1
+fi
+wait
+rm -f results/empty.fifo
+diff results/mergeBaseQCSumEmptyStream.log expected/mergeBaseQCSumEmptyStream.log
+let "status |= $?"
+
 if [ $status != 0 ]
 then
   echo failed mergeBaseQCSum test.
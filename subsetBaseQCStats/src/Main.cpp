@@ -17,8 +17,13 @@
 
 #include "Parameters.h"
 #include "NonOverlapRegions.h"
+#include "../../common/BaseQCSummary.h"
+#include "../../common/StatsStream.h"
+#include "ParallelSubset.h"
 
-int readRegions(String& regions, NonOverlapRegions& regionList);
+int readRegions(String& regions, NonOverlapRegions& regionList,
+                BaseQCSummary* summary, ParallelSubset* parallelSubset);
+bool readInputLine(IFILE inputFile, FILE* inputStream);
 bool writeLine(IFILE outputFile);
 
 const unsigned int BUFFER_SIZE = 1000;
@@ -27,17 +32,27 @@ char readBuffer[BUFFER_SIZE];
 // Just for the chromosome buffer.
 const unsigned int CHROM_BUFFER_SIZE = 100;
 
+const char* shortHdrStr = "chrom\tchromStart\tZeroMapQual\tAverageMapQuality\tAverageMapQualCount";
+
 int main(int argc, char ** argv)
 {
     String input;
     String regions;
     String output;
+    String summaryFile;
+    bool regionSummary = false;
+    int numThreads = 1;
+    int chunkSize = 1 << 20;
 
     ParameterList inputParameters;
     BEGIN_LONG_PARAMETERS(longParameterList)
         LONG_STRINGPARAMETER("inStats", &input)
         LONG_STRINGPARAMETER("regionList", &regions)
         LONG_STRINGPARAMETER("outStats", &output)
+        LONG_STRINGPARAMETER("summary", &summaryFile)
+        LONG_PARAMETER("regionSummary", &regionSummary)
+        LONG_INTPARAMETER("threads", &numThreads)
+        LONG_INTPARAMETER("chunkSize", &chunkSize)
         END_LONG_PARAMETERS();
    
     inputParameters.Add(new LongParameters ("Input Parameters", 
@@ -50,18 +65,58 @@ int main(int argc, char ** argv)
     {
         // The required parameters were not specified.
         std::cerr << "Narrow down the stats to just a subset of positions.\n";
-        std::cerr << "Usage: subsetBaseQCStats --inStats <originalStatsFile> --regionList <subset of regions> --outStats <outputStatsFile>\n"
+        std::cerr << "Usage: subsetBaseQCStats --inStats <originalStatsFile> --regionList <subset of regions> --outStats <outputStatsFile> [--summary <summaryFile> [--regionSummary]] [--threads <numThreads> [--chunkSize <bytes>]]\n"
                   << "\n";
-        std::cerr << "\t\t--inStats    : stats file to narrow down to just a subset of positions" << std::endl;
+        std::cerr << "\t\t--inStats    : stats file to narrow down to just a subset of positions\n"
+                  << "\t\t               '-' (stdin) and named pipes are read as they are written\n"
+                  << "\t\t               and must be uncompressed." << std::endl;
         std::cerr << "\t\t--regionList : File containing the subset of regions to keep (assumed to be sorted)\n"
                   << "\t\t               Formated as chr<tab>start_pos<tab>end_pos.\n" 
                   << "\t\t               Positions are 0 based and the end_pos is not included in the region." << std::endl;
-        std::cerr << "\t\t--outStats   : stats file to write the subset of stats into" << std::endl;
+        std::cerr << "\t\t--outStats   : stats file to write the subset of stats into ('-' for stdout)" << std::endl;
+        std::cerr << "\t\t--summary    : write per chromosome depth/quality metrics of the kept stats to this file\n"
+                  << "\t\t               Chromosome metrics only cover positions with a stats record." << std::endl;
+        std::cerr << "\t\t--regionSummary : also write summary metrics for each region in the regionList\n"
+                  << "\t\t               Region metrics cover every base, bases without a record have depth 0." << std::endl;
+        std::cerr << "\t\t--threads    : number of threads to filter the stats with (default 1)\n"
+                  << "\t\t               BGZF input is decompressed by the threads, other input is\n"
+                  << "\t\t               read and decompressed by a single thread." << std::endl;
+        std::cerr << "\t\t--chunkSize  : bytes of (uncompressed) input each thread filters at a time\n"
+                  << "\t\t               (default 1048576)" << std::endl;
+        return(-1);
+    }
+
+    if(numThreads < 1)
+    {
+        std::cerr << "--threads must be at least 1, exiting.\n";
+        return(-1);
+    }
+
+    if(chunkSize < 1)
+    {
+        std::cerr << "--chunkSize must be at least 1, exiting.\n";
         return(-1);
     }
 
-    IFILE inStats = ifopen(input, "r");
-    if(inStats == NULL)
+    if(regionSummary && summaryFile.IsEmpty())
+    {
+        std::cerr << "--regionSummary is only used with --summary, exiting.\n";
+        return(-1);
+    }
+
+    // stdin and named pipes are read directly rather than through ifopen,
+    // which may reopen the file when checking the compression type.
+    IFILE inStats = NULL;
+    FILE* inStream = NULL;
+    if(isStatsStream(input))
+    {
+        inStream = (input == "-") ? stdin : fopen(input, "r");
+    }
+    else
+    {
+        inStats = ifopen(input, "r");
+    }
+    if((inStats == NULL) && (inStream == NULL))
     {
         std::cerr << "Failed to open input stats file: " << input << std::endl;
         return(-1);
@@ -71,16 +126,34 @@ int main(int argc, char ** argv)
     {
         std::cerr << "Failed to open output stats file: " << output 
                   << std::endl;
-        ifclose(inStats);
+        if(inStats != NULL)
+        {
+            ifclose(inStats);
+        }
+        else if(inStream != stdin)
+        {
+            fclose(inStream);
+        }
         return(-1);
     }
 
     NonOverlapRegions regionList;
-    int regionStat = readRegions(regions, regionList);
+    BaseQCSummary qcSummary;
+    ParallelSubset parallelSubset;
+    int regionStat = readRegions(regions, regionList,
+                                 regionSummary ? &qcSummary : NULL,
+                                 (numThreads > 1) ? &parallelSubset : NULL);
 
     if(regionStat != 0)
     {
-        ifclose(inStats);
+        if(inStats != NULL)
+        {
+            ifclose(inStats);
+        }
+        else if(inStream != stdin)
+        {
+            fclose(inStream);
+        }
         ifclose(outStats);
         return(regionStat);
     }
@@ -91,16 +164,22 @@ int main(int argc, char ** argv)
     char chrom[CHROM_BUFFER_SIZE];
     int pos;
     bool firstLine = true;
+    int numLines = 0;
     // Keep reading the input file until the end is reached.
-    while(!inStats->ifgetline(readBuffer, BUFFER_SIZE))
+    // With multiple threads, only the first (header) line is read here.
+    while(((numThreads == 1) || (numLines == 0)) &&
+          !readInputLine(inStats, inStream))
     {
+        ++numLines;
         // Read a line from the file, parsing it to get the position.
         if(sscanf(readBuffer, "%s\t%d", chrom, &pos) != 2)
         {
             // Failed to read the line.
             if(firstLine)
             {
-                // Header line.
+                // Header line, check the format before writeLine appends
+                // the newline to readBuffer.
+                qcSummary.setFullStats(strcmp(readBuffer, shortHdrStr) != 0);
                 error &= writeLine(outStats);
                 firstLine = false;
             }
@@ -114,14 +193,53 @@ int main(int argc, char ** argv)
         // Successfully read/parsed the line, so check if it is in the region.
         if(regionList.inRegion(chrom, pos))
         {
+            if(!summaryFile.IsEmpty() && !qcSummary.addLine(readBuffer))
+            {
+                std::cerr << "Failed to read the summary fields from one of the stats lines.\n";
+                error = true;
+            }
             error &= writeLine(outStats);
         }
     }
 
+    if((numThreads > 1) && (numLines != 0))
+    {
+        // The threads decompress BGZF input themselves, so it is read
+        // directly rather than through inStats.
+        FILE* bgzfStats = NULL;
+        if(inStats != NULL)
+        {
+            bgzfStats = ParallelSubset::openBgzf(input);
+        }
+        parallelSubset.setChunkSize(chunkSize);
+        if(!parallelSubset.run(numThreads, inStats, inStream, bgzfStats,
+                               outStats,
+                               summaryFile.IsEmpty() ? NULL : &qcSummary))
+        {
+            error = true;
+        }
+        if(bgzfStats != NULL)
+        {
+            fclose(bgzfStats);
+        }
+    }
+
     // Done reading the input file.
-    ifclose(inStats);
+    if(inStats != NULL)
+    {
+        ifclose(inStats);
+    }
+    else if(inStream != stdin)
+    {
+        fclose(inStream);
+    }
     ifclose(outStats);
 
+    if(!summaryFile.IsEmpty() && !qcSummary.write(summaryFile))
+    {
+        error = true;
+    }
+
     std::cerr << "Done subsetBaseQCStats.\n";
 
     if(error)
@@ -132,7 +250,8 @@ int main(int argc, char ** argv)
 }
 
  
-int readRegions(String& regions, NonOverlapRegions& regionList)
+int readRegions(String& regions, NonOverlapRegions& regionList,
+                BaseQCSummary* summary, ParallelSubset* parallelSubset)
 {
     IFILE inRegions = ifopen(regions, "r");
     if(inRegions == NULL)
@@ -152,6 +271,14 @@ int readRegions(String& regions, NonOverlapRegions& regionList)
         {
             // Successfully read a line.
             regionList.add(chrom, atoi(startStr), atoi(endStr));
+            if(summary != NULL)
+            {
+                summary->addRegion(chrom, atoi(startStr), atoi(endStr));
+            }
+            if(parallelSubset != NULL)
+            {
+                parallelSubset->addRegion(chrom, atoi(startStr), atoi(endStr));
+            }
         }
         else
         {
@@ -159,10 +286,49 @@ int readRegions(String& regions, NonOverlapRegions& regionList)
             std::cerr << "Invalid Line found in region list, continuing.\n";
         }
     }
+    ifclose(inRegions);
+    if(summary != NULL)
+    {
+        summary->finishRegions();
+    }
+    if(parallelSubset != NULL)
+    {
+        parallelSubset->finishRegions();
+    }
     return(0);
 }
 
 
+// Read the next line into readBuffer, returns true at the end of the input
+// (same as ifgetline).
+bool readInputLine(IFILE inputFile, FILE* inputStream)
+{
+    if(inputFile != NULL)
+    {
+        return(inputFile->ifgetline(readBuffer, BUFFER_SIZE));
+    }
+    if(fgets(readBuffer, BUFFER_SIZE, inputStream) == NULL)
+    {
+        return(true);
+    }
+    unsigned int len = strlen(readBuffer);
+    if((len > 0) && (readBuffer[len-1] == '\n'))
+    {
+        readBuffer[len-1] = '\0';
+    }
+    else
+    {
+        // Line is longer than the buffer, discard the rest of it.
+        int ch = fgetc(inputStream);
+        while((ch != '\n') && (ch != EOF))
+        {
+            ch = fgetc(inputStream);
+        }
+    }
+    return(false);
+}
+
+
 bool writeLine(IFILE outputFile)
 {
     static unsigned int writeLen = 0;
@@ -186,3 +352,4 @@ bool writeLine(IFILE outputFile)
     }
     return(true);
 }
+
@@ -0,0 +1,593 @@
+/*
+ *  Copyright (C) 2011  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ParallelSubset.h"
+
+#include <string.h>
+#include <zlib.h>
+#include <algorithm>
+#include <iostream>
+
+ParallelSubset::ParallelSubset()
+    : myRegions(),
+      myChunkSize(DEFAULT_CHUNK_SIZE),
+      myInputFile(NULL),
+      myInputStream(NULL),
+      myBgzfInput(NULL),
+      myInputFailed(false),
+      mySummary(NULL),
+      myWorkQueue(),
+      myInputDone(false),
+      myCarry(),
+      mySkipLine(false)
+{
+    pthread_mutex_init(&myMutex, NULL);
+    pthread_cond_init(&myWorkCond, NULL);
+    pthread_cond_init(&myDoneCond, NULL);
+}
+
+
+ParallelSubset::~ParallelSubset()
+{
+    pthread_cond_destroy(&myDoneCond);
+    pthread_cond_destroy(&myWorkCond);
+    pthread_mutex_destroy(&myMutex);
+}
+
+
+void ParallelSubset::addRegion(const char* chrom, int start, int end)
+{
+    if(start >= end)
+    {
+        // NonOverlapRegions already reports invalid regions.
+        return;
+    }
+    myRegions[chrom].push_back(std::make_pair(start, end));
+}
+
+
+void ParallelSubset::finishRegions()
+{
+    // Sort each chromosome's regions and merge the overlapping ones so a
+    // position can be looked up with a single binary search.
+    for(RegionMap::iterator iter = myRegions.begin();
+        iter != myRegions.end(); iter++)
+    {
+        RegionVector& regions = iter->second;
+        std::sort(regions.begin(), regions.end());
+        unsigned int numMerged = 0;
+        for(unsigned int i = 0; i < regions.size(); i++)
+        {
+            if((numMerged != 0) &&
+               (regions[i].first <= regions[numMerged-1].second))
+            {
+                regions[numMerged-1].second =
+                    std::max(regions[numMerged-1].second, regions[i].second);
+            }
+            else
+            {
+                regions[numMerged] = regions[i];
+                ++numMerged;
+            }
+        }
+        regions.resize(numMerged);
+    }
+}
+
+
+void ParallelSubset::setChunkSize(unsigned int chunkSize)
+{
+    myChunkSize = chunkSize;
+}
+
+
+FILE* ParallelSubset::openBgzf(const char* filename)
+{
+    FILE* bgzfFile = fopen(filename, "rb");
+    if(bgzfFile == NULL)
+    {
+        return(NULL);
+    }
+    // Check that the first block is BGZF (a gzip member with a BC field).
+    std::vector<unsigned char> header(BGZF_HEADER_SIZE);
+    bool isBgzf = false;
+    if(fread(&(header[0]), 1, BGZF_HEADER_SIZE, bgzfFile) == BGZF_HEADER_SIZE)
+    {
+        unsigned int extraLen = header[10] | (header[11] << 8);
+        header.resize(BGZF_HEADER_SIZE + extraLen);
+        isBgzf =
+            (fread(&(header[BGZF_HEADER_SIZE]), 1, extraLen, bgzfFile) == extraLen) &&
+            (getBgzfBlockSize(&(header[0])) != 0);
+    }
+    if(!isBgzf || (fseek(bgzfFile, 0, SEEK_SET) != 0))
+    {
+        fclose(bgzfFile);
+        return(NULL);
+    }
+    return(bgzfFile);
+}
+
+
+bool ParallelSubset::run(int numThreads, IFILE inputFile, FILE* inputStream,
+                         FILE* bgzfInput, IFILE outputFile,
+                         BaseQCSummary* summary)
+{
+    myInputFile = inputFile;
+    myInputStream = inputStream;
+    myBgzfInput = bgzfInput;
+    myInputFailed = false;
+    myInputDone = false;
+    myCarry.clear();
+    // The BGZF input is read from the start of the file.
+    mySkipLine = (bgzfInput != NULL);
+    mySummary = summary;
+
+    std::vector<pthread_t> threads(numThreads);
+    for(int i = 0; i < numThreads; i++)
+    {
+        if(pthread_create(&(threads[i]), NULL, workerThread, this) != 0)
+        {
+            std::cerr << "Failed to create subset thread.\n";
+            threads.resize(i);
+            break;
+        }
+    }
+
+    bool status = true;
+    std::deque<Chunk*> inFlight;
+    if(threads.empty())
+    {
+        status = false;
+    }
+    else
+    {
+        while(true)
+        {
+            Chunk* chunk = new Chunk;
+            if(!readChunk(*chunk))
+            {
+                delete chunk;
+                break;
+            }
+            chunk->numFailed = 0;
+            chunk->numSummaryFailed = 0;
+            chunk->inflateFailed = false;
+            chunk->done = false;
+
+            pthread_mutex_lock(&myMutex);
+            myWorkQueue.push_back(chunk);
+            pthread_cond_signal(&myWorkCond);
+            pthread_mutex_unlock(&myMutex);
+
+            // Limit how far the reader gets ahead of the writer.
+            inFlight.push_back(chunk);
+            status &= writeDoneChunks(inFlight,
+                                      inFlight.size() >= threads.size() * CHUNKS_PER_THREAD,
+                                      outputFile, summary);
+        }
+    }
+
+    pthread_mutex_lock(&myMutex);
+    myInputDone = true;
+    pthread_cond_broadcast(&myWorkCond);
+    pthread_mutex_unlock(&myMutex);
+
+    while(!inFlight.empty())
+    {
+        status &= writeDoneChunks(inFlight, true, outputFile, summary);
+    }
+
+    if(!myCarry.empty())
+    {
+        // Last line of the input without a trailing newline.
+        status &= writeCarry(outputFile, summary);
+    }
+
+    for(unsigned int i = 0; i < threads.size(); i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    if(myInputFailed)
+    {
+        status = false;
+    }
+    mySummary = NULL;
+    myInputFile = NULL;
+    myInputStream = NULL;
+    myBgzfInput = NULL;
+    return(status);
+}
+
+
+void* ParallelSubset::workerThread(void* parallelSubset)
+{
+    ((ParallelSubset*)parallelSubset)->work();
+    return(NULL);
+}
+
+
+void ParallelSubset::work()
+{
+    while(true)
+    {
+        pthread_mutex_lock(&myMutex);
+        while(myWorkQueue.empty() && !myInputDone)
+        {
+            pthread_cond_wait(&myWorkCond, &myMutex);
+        }
+        if(myWorkQueue.empty())
+        {
+            // No more input.
+            pthread_mutex_unlock(&myMutex);
+            return;
+        }
+        Chunk* chunk = myWorkQueue.front();
+        myWorkQueue.pop_front();
+        pthread_mutex_unlock(&myMutex);
+
+        if(!chunk->blocks.empty())
+        {
+            chunk->inflateFailed = !inflateBlocks(*chunk);
+        }
+        splitChunk(*chunk);
+
+        pthread_mutex_lock(&myMutex);
+        chunk->done = true;
+        pthread_cond_broadcast(&myDoneCond);
+        pthread_mutex_unlock(&myMutex);
+    }
+}
+
+
+bool ParallelSubset::readChunk(Chunk& chunk)
+{
+    chunk.inflatedSize = 0;
+    if(myBgzfInput != NULL)
+    {
+        // Read whole blocks until there is a chunk's worth of input.
+        while((chunk.inflatedSize < myChunkSize) &&
+              readBgzfBlock(chunk.blocks, chunk.inflatedSize))
+        {
+        }
+        return(!chunk.blocks.empty());
+    }
+
+    chunk.data.resize(myChunkSize);
+    unsigned int numRead = 0;
+    if(myInputFile != NULL)
+    {
+        numRead = myInputFile->ifread(&(chunk.data[0]), myChunkSize);
+    }
+    else
+    {
+        numRead = fread(&(chunk.data[0]), 1, myChunkSize, myInputStream);
+    }
+    chunk.data.resize(numRead);
+    return(numRead != 0);
+}
+
+
+bool ParallelSubset::readBgzfBlock(std::vector<char>& blocks,
+                                   unsigned int& inflatedSize)
+{
+    if(myInputFailed)
+    {
+        return(false);
+    }
+    unsigned int blockStart = blocks.size();
+    blocks.resize(blockStart + BGZF_HEADER_SIZE);
+    unsigned int numRead = fread(&(blocks[blockStart]), 1, BGZF_HEADER_SIZE,
+                                 myBgzfInput);
+    unsigned int blockSize = 0;
+    if(numRead == BGZF_HEADER_SIZE)
+    {
+        // Read the extra field to get the block size.
+        unsigned char* header = (unsigned char*)&(blocks[blockStart]);
+        unsigned int extraLen = header[10] | (header[11] << 8);
+        blocks.resize(blockStart + BGZF_HEADER_SIZE + extraLen);
+        if(fread(&(blocks[blockStart + BGZF_HEADER_SIZE]), 1, extraLen,
+                 myBgzfInput) == extraLen)
+        {
+            blockSize =
+                getBgzfBlockSize((unsigned char*)&(blocks[blockStart]));
+        }
+        if(blockSize < BGZF_HEADER_SIZE + extraLen + BGZF_FOOTER_SIZE)
+        {
+            blockSize = 0;
+        }
+        else
+        {
+            // Read the rest of the block.
+            unsigned int readSize = blocks.size() - blockStart;
+            blocks.resize(blockStart + blockSize);
+            if(fread(&(blocks[blockStart + readSize]), 1,
+                     blockSize - readSize, myBgzfInput) != blockSize - readSize)
+            {
+                blockSize = 0;
+            }
+        }
+    }
+    if(blockSize == 0)
+    {
+        blocks.resize(blockStart);
+        if(numRead != 0)
+        {
+            std::cerr << "Failed to read a BGZF block from the input file.\n";
+            myInputFailed = true;
+        }
+        return(false);
+    }
+
+    // The inflated size is the last 4 bytes of the block.
+    unsigned char* footer =
+        (unsigned char*)&(blocks[blockStart + blockSize - 4]);
+    inflatedSize += footer[0] | (footer[1] << 8) | (footer[2] << 16) |
+        (footer[3] << 24);
+    return(true);
+}
+
+
+unsigned int ParallelSubset::getBgzfBlockSize(const unsigned char* header)
+{
+    // gzip magic, deflate, and the FEXTRA flag.
+    if((header[0] != 31) || (header[1] != 139) || (header[2] != 8) ||
+       ((header[3] & 4) == 0))
+    {
+        return(0);
+    }
+    // Find the BC subfield, which holds the block size - 1.
+    unsigned int extraLen = header[10] | (header[11] << 8);
+    const unsigned char* extra = header + BGZF_HEADER_SIZE;
+    unsigned int pos = 0;
+    while(pos + 4 <= extraLen)
+    {
+        unsigned int fieldLen = extra[pos+2] | (extra[pos+3] << 8);
+        if((extra[pos] == 'B') && (extra[pos+1] == 'C') && (fieldLen == 2) &&
+           (pos + 6 <= extraLen))
+        {
+            return((extra[pos+4] | (extra[pos+5] << 8)) + 1);
+        }
+        pos += 4 + fieldLen;
+    }
+    return(0);
+}
+
+
+bool ParallelSubset::inflateBlocks(Chunk& chunk) const
+{
+    chunk.data.resize(chunk.inflatedSize);
+    unsigned int inflated = 0;
+    unsigned int blockStart = 0;
+    bool status = true;
+    while(status && (blockStart < chunk.blocks.size()))
+    {
+        unsigned char* block = (unsigned char*)&(chunk.blocks[blockStart]);
+        unsigned int blockSize = getBgzfBlockSize(block);
+        unsigned int extraLen = block[10] | (block[11] << 8);
+        unsigned char* footer = block + blockSize - BGZF_FOOTER_SIZE;
+        unsigned int crc = footer[0] | (footer[1] << 8) | (footer[2] << 16) |
+            (footer[3] << 24);
+        unsigned int blockInflatedSize = footer[4] | (footer[5] << 8) |
+            (footer[6] << 16) | (footer[7] << 24);
+
+        if(blockInflatedSize != 0)
+        {
+            // Each block is a raw deflate stream.
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            stream.next_in = block + BGZF_HEADER_SIZE + extraLen;
+            stream.avail_in =
+                blockSize - BGZF_HEADER_SIZE - extraLen - BGZF_FOOTER_SIZE;
+            stream.next_out = (unsigned char*)&(chunk.data[inflated]);
+            stream.avail_out = blockInflatedSize;
+            status = (inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+            if(status)
+            {
+                status = (inflate(&stream, Z_FINISH) == Z_STREAM_END) &&
+                    (stream.total_out == blockInflatedSize);
+                inflateEnd(&stream);
+            }
+            status = status &&
+                (crc32(crc32(0L, Z_NULL, 0),
+                       (unsigned char*)&(chunk.data[inflated]),
+                       blockInflatedSize) == crc);
+        }
+        inflated += blockInflatedSize;
+        blockStart += blockSize;
+    }
+    // The compressed blocks are no longer needed.
+    std::vector<char>().swap(chunk.blocks);
+    if(!status)
+    {
+        chunk.data.clear();
+    }
+    return(status);
+}
+
+
+void ParallelSubset::splitChunk(Chunk& chunk) const
+{
+    char* dataStart = chunk.data.empty() ? NULL : &(chunk.data[0]);
+    char* dataEnd = dataStart + chunk.data.size();
+    char* firstNewline = NULL;
+    if(dataStart != NULL)
+    {
+        firstNewline = (char*)memchr(dataStart, '\n', chunk.data.size());
+    }
+    chunk.hasNewline = (firstNewline != NULL);
+    if(!chunk.hasNewline)
+    {
+        // The whole chunk is in the middle of a line.
+        chunk.head.assign(dataStart, chunk.data.size());
+    }
+    else
+    {
+        char* lastNewline = dataEnd - 1;
+        while(*lastNewline != '\n')
+        {
+            --lastNewline;
+        }
+        chunk.head.assign(dataStart, firstNewline - dataStart);
+        chunk.tail.assign(lastNewline + 1, dataEnd - lastNewline - 1);
+        filterLines(chunk, firstNewline + 1, lastNewline + 1);
+    }
+    // The input is no longer needed.
+    std::vector<char>().swap(chunk.data);
+}
+
+
+void ParallelSubset::filterLines(Chunk& chunk, char* line, char* dataEnd) const
+{
+    char chrom[100];
+    int pos;
+    RegionMap::const_iterator regionIter = myRegions.end();
+    std::string prevChrom;
+
+    while(line < dataEnd)
+    {
+        char* lineEnd = (char*)memchr(line, '\n', dataEnd - line);
+        // Terminate the line so the parsing cannot run into the next one.
+        *lineEnd = '\0';
+        if(sscanf(line, "%99s\t%d", chrom, &pos) != 2)
+        {
+            ++chunk.numFailed;
+        }
+        else
+        {
+            // Lines are grouped by chromosome, so only look it up when
+            // it changes.
+            if((regionIter == myRegions.end()) || (prevChrom != chrom))
+            {
+                prevChrom = chrom;
+                regionIter = myRegions.find(prevChrom);
+            }
+            if(regionIter != myRegions.end())
+            {
+                // Find the last region starting at or before pos.
+                const RegionVector& regions = regionIter->second;
+                RegionVector::const_iterator region =
+                    std::upper_bound(regions.begin(), regions.end(),
+                                     std::make_pair(pos, 0x7FFFFFFF));
+                if((region != regions.begin()) && ((--region)->second > pos))
+                {
+                    if((mySummary != NULL) &&
+                       !mySummary->addLine(chunk.summary, line))
+                    {
+                        ++chunk.numSummaryFailed;
+                    }
+                    chunk.output.append(line, lineEnd - line);
+                    chunk.output.push_back('\n');
+                }
+            }
+        }
+        line = lineEnd + 1;
+    }
+}
+
+
+bool ParallelSubset::writeChunk(Chunk& chunk, IFILE outputFile,
+                                BaseQCSummary* summary)
+{
+    bool status = true;
+    if(chunk.inflateFailed)
+    {
+        std::cerr << "Failed to decompress a BGZF block of the input file.\n";
+        status = false;
+    }
+
+    for(int i = 0; i < chunk.numFailed; i++)
+    {
+        std::cerr << "Failed to read one of the stats lines from the input file.\n";
+        status = false;
+    }
+
+    for(int i = 0; i < chunk.numSummaryFailed; i++)
+    {
+        std::cerr << "Failed to read the summary fields from one of the stats lines.\n";
+        status = false;
+    }
+    if(summary != NULL)
+    {
+        summary->merge(chunk.summary);
+    }
+
+    if(outputFile->ifwrite(chunk.output.c_str(), chunk.output.size()) !=
+       chunk.output.size())
+    {
+        std::cerr << "subsetBaseQCStats: Failed to write to the output file.\n";
+        status = false;
+    }
+    return(status);
+}
+
+
+bool ParallelSubset::writeCarry(IFILE outputFile, BaseQCSummary* summary)
+{
+    if(mySkipLine)
+    {
+        // The header was already written.
+        mySkipLine = false;
+        myCarry.clear();
+        return(true);
+    }
+    Chunk line;
+    line.data.assign(myCarry.begin(), myCarry.end());
+    line.data.push_back('\n');
+    line.numFailed = 0;
+    line.numSummaryFailed = 0;
+    line.inflateFailed = false;
+    myCarry.clear();
+    filterLines(line, &(line.data[0]), &(line.data[0]) + line.data.size());
+    return(writeChunk(line, outputFile, summary));
+}
+
+
+bool ParallelSubset::writeDoneChunks(std::deque<Chunk*>& inFlight, bool wait,
+                                     IFILE outputFile, BaseQCSummary* summary)
+{
+    bool status = true;
+    while(!inFlight.empty())
+    {
+        Chunk* chunk = inFlight.front();
+        pthread_mutex_lock(&myMutex);
+        while(wait && !chunk->done)
+        {
+            pthread_cond_wait(&myDoneCond, &myMutex);
+        }
+        bool done = chunk->done;
+        pthread_mutex_unlock(&myMutex);
+        if(!done)
+        {
+            break;
+        }
+
+        // The head finishes the line started in the previous chunks, which
+        // comes before this chunk's lines.
+        myCarry.append(chunk->head);
+        if(chunk->hasNewline)
+        {
+            status &= writeCarry(outputFile, summary);
+            myCarry.swap(chunk->tail);
+        }
+        status &= writeChunk(*chunk, outputFile, summary);
+        delete chunk;
+        inFlight.pop_front();
+        // Only wait for the first chunk.
+        wait = false;
+    }
+    return(status);
+}
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (C) 2011  Regents of the University of Michigan
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PARALLEL_SUBSET_H__
+#define __PARALLEL_SUBSET_H__
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "InputFile.h"
+#include "../../common/BaseQCSummary.h"
+
+/// Subsets stats lines to a set of regions using multiple threads.
+/// The input is read in chunks that are split into lines, filtered (and
+/// summarized) in parallel and written in their original order.
+/// For BGZF input, the calling thread only reads the compressed blocks and
+/// the threads inflate them.  Other input is read (and decompressed) by the
+/// calling thread.  Only the line that spans each pair of chunks is
+/// filtered by the calling thread.
+/// The regions are kept in a sorted interval list that is only read while
+/// the threads are running (NonOverlapRegions caches its last lookup, so
+/// it cannot be shared between threads).
+class ParallelSubset
+{
+public:
+    ParallelSubset();
+    ~ParallelSubset();
+
+    /// Add a region to keep (0 based, end not included).
+    /// Invalid regions (start >= end) are ignored.
+    void addRegion(const char* chrom, int start, int end);
+
+    /// Must be called after the last addRegion and before run.
+    void finishRegions();
+
+    /// Set the amount of (uncompressed) input in each chunk.
+    void setChunkSize(unsigned int chunkSize);
+
+    /// Open the file to pass to run if it is BGZF compressed, returns NULL
+    /// if it is not (or could not be opened).
+    static FILE* openBgzf(const char* filename);
+
+    /// Filter the rest of the input to the regions, writing the kept lines
+    /// to outputFile and adding them to summary if it is not NULL.  Each
+    /// chunk's kept lines are summarized by its thread and merged into
+    /// summary in order.
+    /// The input is bgzfInput (from openBgzf) if it is not NULL, skipping
+    /// the first (header) line that was already read through inputFile.
+    /// Otherwise it is inputFile, or inputStream if inputFile is NULL.
+    /// Returns false if any line failed to parse or write.
+    bool run(int numThreads, IFILE inputFile, FILE* inputStream,
+             FILE* bgzfInput, IFILE outputFile, BaseQCSummary* summary);
+
+private:
+    static const unsigned int DEFAULT_CHUNK_SIZE = 1 << 20;
+    // Number of chunks per thread that can be read ahead of the writer.
+    static const unsigned int CHUNKS_PER_THREAD = 4;
+    static const unsigned int BGZF_HEADER_SIZE = 12;
+    static const unsigned int BGZF_FOOTER_SIZE = 8;
+
+    struct Chunk
+    {
+        // Compressed BGZF blocks, inflated into data by the thread.
+        std::vector<char> blocks;
+        unsigned int inflatedSize;
+        std::vector<char> data;
+        // The data before the first newline (the end of the line started
+        // in the previous chunks) and after the last newline.
+        std::string head;
+        std::string tail;
+        bool hasNewline;
+        std::string output;
+        BaseQCSummary::Partial summary;
+        int numFailed;
+        int numSummaryFailed;
+        bool inflateFailed;
+        bool done;
+    };
+
+    typedef std::vector<std::pair<int, int> > RegionVector;
+    typedef std::map<std::string, RegionVector> RegionMap;
+
+    static void* workerThread(void* parallelSubset);
+    void work();
+
+    // Read the next chunk of the input, returns false at the end of the
+    // input (or if the BGZF input is invalid, see myInputFailed).
+    bool readChunk(Chunk& chunk);
+    // Append the next BGZF block to blocks, adding its inflated size.
+    // Returns false at the end of the file or if the block is invalid.
+    bool readBgzfBlock(std::vector<char>& blocks, unsigned int& inflatedSize);
+    // Returns the size of the BGZF block starting with the specified header
+    // and extra field, or 0 if it is not a BGZF block.
+    static unsigned int getBgzfBlockSize(const unsigned char* header);
+    bool inflateBlocks(Chunk& chunk) const;
+    // Split the chunk's data into its head, tail, and the complete lines
+    // in between, which are filtered.
+    void splitChunk(Chunk& chunk) const;
+    // Filter the lines in [line, dataEnd), each ending with a newline.
+    void filterLines(Chunk& chunk, char* line, char* dataEnd) const;
+    bool writeChunk(Chunk& chunk, IFILE outputFile, BaseQCSummary* summary);
+    // Filter and write the line spanning the chunks (myCarry).
+    bool writeCarry(IFILE outputFile, BaseQCSummary* summary);
+    // Write the chunks that are done, in order, waiting for the first one
+    // if wait is true.
+    bool writeDoneChunks(std::deque<Chunk*>& inFlight, bool wait,
+                         IFILE outputFile, BaseQCSummary* summary);
+
+    RegionMap myRegions;
+    unsigned int myChunkSize;
+
+    // Input for the duration of run.
+    IFILE myInputFile;
+    FILE* myInputStream;
+    FILE* myBgzfInput;
+    bool myInputFailed;
+    // Only read by the threads, set for the duration of run.
+    const BaseQCSummary* mySummary;
+
+    pthread_mutex_t myMutex;
+    // Signaled when a chunk is queued or there is no more input.
+    pthread_cond_t myWorkCond;
+    // Signaled when a chunk has been filtered.
+    pthread_cond_t myDoneCond;
+    std::deque<Chunk*> myWorkQueue;
+    bool myInputDone;
+
+    // Start of the line that continues into the next chunk.
+    std::string myCarry;
+    // Whether the next complete line is the header, which is skipped.
+    bool mySkipLine;
+};
+
+#endif
@@ -8,6 +8,88 @@ let "status |= $?"
 diff results/statsBaseQCSum.log expected/statsBaseQCSum.log
 let "status |= $?"
 
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSum.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumSummary.txt --summary results/statsBaseQCSumSummary.summary --regionSummary 2> results/statsBaseQCSumSummary.log
+let "status |= $?"
+diff results/statsBaseQCSumSummary.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumSummary.summary expected/statsBaseQCSumSummary.summary
+let "status |= $?"
+diff results/statsBaseQCSumSummary.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSumShort.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumShort.txt --summary results/statsBaseQCSumShort.summary --regionSummary 2> results/statsBaseQCSumShort.log
+let "status |= $?"
+diff results/statsBaseQCSumShort.txt expected/statsBaseQCSumShort.txt
+let "status |= $?"
+diff results/statsBaseQCSumShort.summary expected/statsBaseQCSumShort.summary
+let "status |= $?"
+diff results/statsBaseQCSumShort.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSumShort.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumShortThreads.txt --summary results/statsBaseQCSumShortThreads.summary --regionSummary --threads 3 2> results/statsBaseQCSumShortThreads.log
+let "status |= $?"
+diff results/statsBaseQCSumShortThreads.txt expected/statsBaseQCSumShort.txt
+let "status |= $?"
+diff results/statsBaseQCSumShortThreads.summary expected/statsBaseQCSumShort.summary
+let "status |= $?"
+diff results/statsBaseQCSumShortThreads.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+cat testFiles/statsBaseQCSum.txt | ../../bin/subsetBaseQCStats --inStats - --regionList testFiles/regions.txt --outStats - > results/statsBaseQCSumStream.txt 2> results/statsBaseQCSumStream.log
+let "status |= $?"
+diff results/statsBaseQCSumStream.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumStream.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSum.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumThreads.txt --summary results/statsBaseQCSumThreads.summary --regionSummary --threads 4 2> results/statsBaseQCSumThreads.log
+let "status |= $?"
+diff results/statsBaseQCSumThreads.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumThreads.summary expected/statsBaseQCSumSummary.summary
+let "status |= $?"
+diff results/statsBaseQCSumThreads.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+# Small chunks so the threads filter many chunks, some starting and
+# ending mid line, with more chunks than can be in flight at once.
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSum.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumChunks.txt --summary results/statsBaseQCSumChunks.summary --regionSummary --threads 2 --chunkSize 100 2> results/statsBaseQCSumChunks.log
+let "status |= $?"
+diff results/statsBaseQCSumChunks.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumChunks.summary expected/statsBaseQCSumSummary.summary
+let "status |= $?"
+diff results/statsBaseQCSumChunks.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSumShort.txt --regionList testFiles/regions.txt --outStats results/statsBaseQCSumShortChunks.txt --summary results/statsBaseQCSumShortChunks.summary --regionSummary --threads 2 --chunkSize 7 2> results/statsBaseQCSumShortChunks.log
+let "status |= $?"
+diff results/statsBaseQCSumShortChunks.txt expected/statsBaseQCSumShort.txt
+let "status |= $?"
+diff results/statsBaseQCSumShortChunks.summary expected/statsBaseQCSumShort.summary
+let "status |= $?"
+diff results/statsBaseQCSumShortChunks.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+# BGZF input (150 byte blocks), inflated by the threads.
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSum.txt.gz --regionList testFiles/regions.txt --outStats results/statsBaseQCSumBgzf.txt --summary results/statsBaseQCSumBgzf.summary --regionSummary 2> results/statsBaseQCSumBgzf.log
+let "status |= $?"
+diff results/statsBaseQCSumBgzf.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumBgzf.summary expected/statsBaseQCSumSummary.summary
+let "status |= $?"
+diff results/statsBaseQCSumBgzf.log expected/statsBaseQCSum.log
+let "status |= $?"
+
+../../bin/subsetBaseQCStats --inStats testFiles/statsBaseQCSum.txt.gz --regionList testFiles/regions.txt --outStats results/statsBaseQCSumBgzfThreads.txt --summary results/statsBaseQCSumBgzfThreads.summary --regionSummary --threads 3 --chunkSize 100 2> results/statsBaseQCSumBgzfThreads.log
+let "status |= $?"
+diff results/statsBaseQCSumBgzfThreads.txt expected/statsBaseQCSum.txt
+let "status |= $?"
+diff results/statsBaseQCSumBgzfThreads.summary expected/statsBaseQCSumSummary.summary
+let "status |= $?"
+diff results/statsBaseQCSumBgzfThreads.log expected/statsBaseQCSum.log
+let "status |= $?"
+
 if [ $status != 0 ]
 then
   echo failed subsetStats test.